@@ -14,6 +14,27 @@
 
 #include "JVMInvoke.h"
 
+/* ********************************************************************************************** */
+namespace
+{
+	/**
+	 * Writes the time taken by a JVM shutdown phase to the debugger output.
+	 *
+	 * @param phase              the shutdown phase that completed
+	 * @param elapsedNanoseconds the time taken by the phase
+	 */
+	void logShutdownPhase(jvminvoke::ShutdownPhase phase, jlong elapsedNanoseconds)
+	{
+		const char *phaseNames[] = { "Waiting for threads", "Destroying JVM", "Exiting JVM" };
+		char message[128];
+		StringCchPrintfA(message, 128, "CreepWrap: %s took %.3f ms\n", phaseNames[phase],
+				elapsedNanoseconds / 1000000.0);
+		OutputDebugStringA(message);
+
+	} // logShutdownPhase
+
+} // namespace <anonymous>
+
 /* ********************************************************************************************** */
 int WINAPI _tWinMain(HINSTANCE instance, HINSTANCE previousInstance, LPTSTR commandLine,
 		int showCommand)
@@ -32,7 +53,11 @@ int WINAPI _tWinMain(HINSTANCE instance, HINSTANCE previousInstance, LPTSTR comm
 
 	try
 	{
+		// The launcher's main method returns while the game continues on its own threads, so the
+		// default, unbounded shutdown timeout is kept. The game normally ends with System.exit,
+		// which is reported as the exit phase, timed from when the launcher's main method returned
 		jvminvoke::JavaVM javaVM;
+		javaVM.setShutdownCallback(logShutdownPhase);
 
 		const std::string mainClass("net/minecraft/LauncherFrame");
 		if(argc == 1)
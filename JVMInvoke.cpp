@@ -6,30 +6,434 @@
 /* ********************************************************************************************** */
 #include <string.h>
 
+#include <exception>
 #include <memory>
+#include <vector>
 
 #include "JVMInvoke.h"
 
 /* ********************************************************************************************** */
-jvminvoke::JavaVM::JavaVM() : javaVM(NULL), jvmDLLPath()
+namespace
+{
+	/*
+	 * The following functions are the Java-facing bindings of the host intrinsics, registered via
+	 * RegisterNatives. Those taking only primitive arguments also have critical native variants,
+	 * exported below, which HotSpot (from JDK 7u to JDK 15) prefers once the method is compiled.
+	 */
+
+	jlong JNICALL javaNanoTime(JNIEnv*, jclass)
+	{
+		return jvminvoke::highResolutionTime();
+
+	} // javaNanoTime
+
+	jboolean JNICALL javaPinCurrentThread(JNIEnv*, jclass, jint processor)
+	{
+		return jvminvoke::pinCurrentThread(processor) ? JNI_TRUE : JNI_FALSE;
+
+	} // javaPinCurrentThread
+
+	jint JNICALL javaCurrentProcessor(JNIEnv*, jclass)
+	{
+		return jvminvoke::currentProcessor();
+
+	} // javaCurrentProcessor
+
+	jint JNICALL javaCurrentNumaNode(JNIEnv*, jclass)
+	{
+		return jvminvoke::currentNumaNode();
+
+	} // javaCurrentNumaNode
+
+	jboolean JNICALL javaPrefetchFile(JNIEnv *jniEnvironment, jclass, jstring path)
+	{
+		if(path == NULL)
+		{
+			return JNI_FALSE;
+
+		}
+
+		// GetStringChars does not guarantee a terminating null, so copy using the string's length
+		const jsize length = jniEnvironment->GetStringLength(path);
+		const jchar *pathCString = jniEnvironment->GetStringChars(path, NULL);
+		if(pathCString == NULL)
+		{
+			return JNI_FALSE;
+
+		}
+
+		std::wstring widePath(reinterpret_cast<const wchar_t*>(pathCString), length);
+		jniEnvironment->ReleaseStringChars(path, pathCString);
+
+		return jvminvoke::prefetchFile(widePath) ? JNI_TRUE : JNI_FALSE;
+
+	} // javaPrefetchFile
+
+	/**
+	 * Interval between successive checks for live non-daemon threads while waiting for the JVM to
+	 * become idle during shutdown.
+	 */
+	const unsigned long shutdownPollInterval = 10;
+
+	/*
+	 * The exit hook is invoked by the JVM without any reference to the wrapper instance, so the
+	 * state it requires is held here; the Invocation API only supports one JVM per process.
+	 */
+	jvminvoke::ShutdownCallback_f exitHookCallback = NULL;
+	jlong exitHookStartTime = 0;
+
+	/**
+	 * Exit hook passed to the JVM, invoked once <code>Runtime.exit</code> has run the shutdown
+	 * hooks, in place of the JVM's own orderly process exit.
+	 *
+	 * @param exitCode the exit code passed to <code>Runtime.exit</code>
+	 */
+	void JNICALL exitHook(jint exitCode)
+	{
+		// The callback is only set once shutdown() has begun, as no start time is known before
+		if(exitHookCallback != NULL)
+		{
+			exitHookCallback(jvminvoke::SHUTDOWN_EXIT,
+					jvminvoke::highResolutionTime() - exitHookStartTime);
+
+		}
+
+		jvminvoke::forceExit(exitCode);
+
+	} // exitHook
+
+	/**
+	 * Counts the live non-daemon threads in the JVM, excluding the calling thread.
+	 *
+	 * Any local references created by this function are left for the caller to release, and any
+	 * Java exception raised is left pending.
+	 *
+	 * @param  jniEnvironment the JNI environment of the calling thread
+	 * @return the number of live non-daemon threads, or <code>-1</code> if a JNI call failed
+	 */
+	int countNonDaemonThreadsInFrame(JNIEnv *jniEnvironment)
+	{
+		jclass threadClass = jniEnvironment->FindClass("java/lang/Thread");
+		jclass threadGroupClass = jniEnvironment->FindClass("java/lang/ThreadGroup");
+		if(threadClass == NULL || threadGroupClass == NULL)
+		{
+			return -1;
+
+		}
+
+		jmethodID currentThread = jniEnvironment->GetStaticMethodID(threadClass, "currentThread",
+				"()Ljava/lang/Thread;");
+		jmethodID getThreadGroup = jniEnvironment->GetMethodID(threadClass, "getThreadGroup",
+				"()Ljava/lang/ThreadGroup;");
+		jmethodID isDaemon = jniEnvironment->GetMethodID(threadClass, "isDaemon", "()Z");
+		jmethodID getParent = jniEnvironment->GetMethodID(threadGroupClass, "getParent",
+				"()Ljava/lang/ThreadGroup;");
+		jmethodID activeCount = jniEnvironment->GetMethodID(threadGroupClass, "activeCount", "()I");
+		jmethodID enumerate = jniEnvironment->GetMethodID(threadGroupClass, "enumerate",
+				"([Ljava/lang/Thread;Z)I");
+		if(currentThread == NULL || getThreadGroup == NULL || isDaemon == NULL ||
+				getParent == NULL || activeCount == NULL || enumerate == NULL)
+		{
+			return -1;
+
+		}
+
+		jobject self = jniEnvironment->CallStaticObjectMethod(threadClass, currentThread);
+		if(jniEnvironment->ExceptionCheck())
+		{
+			return -1;
+
+		}
+
+		// Walk up to the root thread group, which contains every thread in the JVM
+		jobject group = jniEnvironment->CallObjectMethod(self, getThreadGroup);
+		for(jobject parent = group; parent != NULL;
+				parent = jniEnvironment->CallObjectMethod(group, getParent))
+		{
+			group = parent;
+
+		}
+
+		if(jniEnvironment->ExceptionCheck() || group == NULL)
+		{
+			return -1;
+
+		}
+
+		// activeCount is only an estimate, so leave room for threads started in the meantime
+		jint capacity = jniEnvironment->CallIntMethod(group, activeCount) * 2 + 1;
+		if(jniEnvironment->ExceptionCheck())
+		{
+			return -1;
+
+		}
+
+		jobjectArray threads = jniEnvironment->NewObjectArray(capacity, threadClass, NULL);
+		if(threads == NULL)
+		{
+			return -1;
+
+		}
+
+		jint threadCount = jniEnvironment->CallIntMethod(group, enumerate, threads, JNI_TRUE);
+		if(jniEnvironment->ExceptionCheck())
+		{
+			return -1;
+
+		}
+
+		int nonDaemonCount = 0;
+		for(jint i = 0; i < threadCount; ++i)
+		{
+			jobject thread = jniEnvironment->GetObjectArrayElement(threads, i);
+			if(jniEnvironment->ExceptionCheck())
+			{
+				return -1;
+
+			}
+
+			const bool nonDaemon = !jniEnvironment->IsSameObject(thread, self) &&
+				!jniEnvironment->CallBooleanMethod(thread, isDaemon);
+			if(jniEnvironment->ExceptionCheck())
+			{
+				return -1;
+
+			}
+
+			if(nonDaemon)
+			{
+				++nonDaemonCount;
+
+			}
+
+			jniEnvironment->DeleteLocalRef(thread);
+
+		}
+
+		return nonDaemonCount;
+
+	} // countNonDaemonThreadsInFrame
+
+	/**
+	 * Class file bytes of the host intrinsics class, as documented for hostIntrinsicsClassName.
+	 *
+	 * The class declares only native methods, and therefore has no code to compile; the bytes
+	 * correspond to a class file of version 50.0 (Java 6) with no constructor and no attributes.
+	 */
+	const unsigned char hostIntrinsicsClassBytes[] =
+	{
+		0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x32, 0x00, 0x0e, 0x01, 0x00,
+		0x18, 0x6a, 0x76, 0x6d, 0x69, 0x6e, 0x76, 0x6f, 0x6b, 0x65, 0x2f, 0x48,
+		0x6f, 0x73, 0x74, 0x49, 0x6e, 0x74, 0x72, 0x69, 0x6e, 0x73, 0x69, 0x63,
+		0x73, 0x07, 0x00, 0x01, 0x01, 0x00, 0x10, 0x6a, 0x61, 0x76, 0x61, 0x2f,
+		0x6c, 0x61, 0x6e, 0x67, 0x2f, 0x4f, 0x62, 0x6a, 0x65, 0x63, 0x74, 0x07,
+		0x00, 0x03, 0x01, 0x00, 0x08, 0x6e, 0x61, 0x6e, 0x6f, 0x54, 0x69, 0x6d,
+		0x65, 0x01, 0x00, 0x03, 0x28, 0x29, 0x4a, 0x01, 0x00, 0x10, 0x70, 0x69,
+		0x6e, 0x43, 0x75, 0x72, 0x72, 0x65, 0x6e, 0x74, 0x54, 0x68, 0x72, 0x65,
+		0x61, 0x64, 0x01, 0x00, 0x04, 0x28, 0x49, 0x29, 0x5a, 0x01, 0x00, 0x10,
+		0x63, 0x75, 0x72, 0x72, 0x65, 0x6e, 0x74, 0x50, 0x72, 0x6f, 0x63, 0x65,
+		0x73, 0x73, 0x6f, 0x72, 0x01, 0x00, 0x03, 0x28, 0x29, 0x49, 0x01, 0x00,
+		0x0f, 0x63, 0x75, 0x72, 0x72, 0x65, 0x6e, 0x74, 0x4e, 0x75, 0x6d, 0x61,
+		0x4e, 0x6f, 0x64, 0x65, 0x01, 0x00, 0x0c, 0x70, 0x72, 0x65, 0x66, 0x65,
+		0x74, 0x63, 0x68, 0x46, 0x69, 0x6c, 0x65, 0x01, 0x00, 0x15, 0x28, 0x4c,
+		0x6a, 0x61, 0x76, 0x61, 0x2f, 0x6c, 0x61, 0x6e, 0x67, 0x2f, 0x53, 0x74,
+		0x72, 0x69, 0x6e, 0x67, 0x3b, 0x29, 0x5a, 0x00, 0x31, 0x00, 0x02, 0x00,
+		0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x01, 0x09, 0x00, 0x05, 0x00,
+		0x06, 0x00, 0x00, 0x01, 0x09, 0x00, 0x07, 0x00, 0x08, 0x00, 0x00, 0x01,
+		0x09, 0x00, 0x09, 0x00, 0x0a, 0x00, 0x00, 0x01, 0x09, 0x00, 0x0b, 0x00,
+		0x0a, 0x00, 0x00, 0x01, 0x09, 0x00, 0x0c, 0x00, 0x0d, 0x00, 0x00, 0x00,
+		0x00
+	};
+
+	JNINativeMethod hostIntrinsics[] =
+	{
+		{ const_cast<char*>("nanoTime"), const_cast<char*>("()J"),
+			reinterpret_cast<void*>(javaNanoTime) },
+		{ const_cast<char*>("pinCurrentThread"), const_cast<char*>("(I)Z"),
+			reinterpret_cast<void*>(javaPinCurrentThread) },
+		{ const_cast<char*>("currentProcessor"), const_cast<char*>("()I"),
+			reinterpret_cast<void*>(javaCurrentProcessor) },
+		{ const_cast<char*>("currentNumaNode"), const_cast<char*>("()I"),
+			reinterpret_cast<void*>(javaCurrentNumaNode) },
+		{ const_cast<char*>("prefetchFile"), const_cast<char*>("(Ljava/lang/String;)Z"),
+			reinterpret_cast<void*>(javaPrefetchFile) }
+	};
+
+} // namespace <anonymous>
+
+/* ********************************************************************************************** */
+/*
+ * Critical native variants of the host intrinsics. When a method bound by RegisterNatives is
+ * compiled, HotSpot loads the module containing the bound function and looks up a
+ * <code>JavaCritical_</code> symbol in it, which it then calls directly, without a JNIEnv or jclass
+ * and without a thread state transition. These must therefore be exported from the executable.
+ */
+extern "C"
+{
+	JNIEXPORT jlong JNICALL JavaCritical_jvminvoke_HostIntrinsics_nanoTime()
+	{
+		return jvminvoke::highResolutionTime();
+
+	} // JavaCritical_jvminvoke_HostIntrinsics_nanoTime
+
+	JNIEXPORT jboolean JNICALL JavaCritical_jvminvoke_HostIntrinsics_pinCurrentThread(
+			jint processor)
+	{
+		return jvminvoke::pinCurrentThread(processor) ? JNI_TRUE : JNI_FALSE;
+
+	} // JavaCritical_jvminvoke_HostIntrinsics_pinCurrentThread
+
+	JNIEXPORT jint JNICALL JavaCritical_jvminvoke_HostIntrinsics_currentProcessor()
+	{
+		return jvminvoke::currentProcessor();
+
+	} // JavaCritical_jvminvoke_HostIntrinsics_currentProcessor
+
+	JNIEXPORT jint JNICALL JavaCritical_jvminvoke_HostIntrinsics_currentNumaNode()
+	{
+		return jvminvoke::currentNumaNode();
+
+	} // JavaCritical_jvminvoke_HostIntrinsics_currentNumaNode
+
+} // extern "C"
+
+/* ********************************************************************************************** */
+jvminvoke::JavaVM::JavaVM() : javaVM(NULL), jvmDLLPath(),
+	shutdownTimeout(infiniteShutdownTimeout), shutdownExitCode(1), shutdownCallback(NULL)
 {
 } // jvminvoke::JavaVM::JavaVM
 
 /* ********************************************************************************************** */
-jvminvoke::JavaVM::JavaVM(const string jvmDLLPath) : javaVM(NULL), jvmDLLPath(jvmDLLPath)
+jvminvoke::JavaVM::JavaVM(const string jvmDLLPath) : javaVM(NULL), jvmDLLPath(jvmDLLPath),
+	shutdownTimeout(infiniteShutdownTimeout), shutdownExitCode(1), shutdownCallback(NULL)
 {
 } // jvminvoke::JavaVM::JavaVM
 
 /* ********************************************************************************************** */
 jvminvoke::JavaVM::~JavaVM()
 {
-	if(javaVM != NULL)
+	shutdown();
+
+} // jvminvoke::JavaVM::~JavaVM
+
+/* ********************************************************************************************** */
+void jvminvoke::JavaVM::setShutdownTimeout(const long milliseconds, const int exitCode)
+{
+	shutdownTimeout = milliseconds;
+	shutdownExitCode = exitCode;
+
+} // jvminvoke::JavaVM::setShutdownTimeout
+
+/* ********************************************************************************************** */
+void jvminvoke::JavaVM::setShutdownCallback(ShutdownCallback_f callback)
+{
+	shutdownCallback = callback;
+
+} // jvminvoke::JavaVM::setShutdownCallback
+
+/* ********************************************************************************************** */
+void jvminvoke::JavaVM::shutdown()
+{
+	if(javaVM == NULL)
+	{
+		return;
+
+	}
+
+	// A failed call to executeJAR may have left a Java exception pending
+	jniEnvironment->ExceptionClear();
+
+	// Should the application call System.exit from here on, the exit hook reports the time
+	// elapsed since the start of the current phase
+	exitHookCallback = shutdownCallback;
+	exitHookStartTime = highResolutionTime();
+
+	if(shutdownTimeout == infiniteShutdownTimeout)
 	{
+		// DestroyJavaVM waits for the last non-daemon thread to terminate, runs the shutdown
+		// hooks, and returns after a full teardown of the JVM
+		const jlong destroyStartTime = highResolutionTime();
+		exitHookStartTime = destroyStartTime;
 		javaVM->DestroyJavaVM();
+		javaVM = NULL;
+		reportShutdownPhase(SHUTDOWN_DESTROY, destroyStartTime);
+		return;
 
 	}
 
-} // jvminvoke::JavaVM::~JavaVM
+	const jlong waitStartTime = highResolutionTime();
+	const jlong deadline = waitStartTime + static_cast<jlong>(shutdownTimeout) * 1000000;
+	int remainingThreads;
+	while((remainingThreads = countNonDaemonThreads()) != 0 && highResolutionTime() < deadline)
+	{
+		sleepMilliseconds(shutdownPollInterval);
+
+	}
+
+	reportShutdownPhase(SHUTDOWN_WAIT_FOR_THREADS, waitStartTime);
+
+	if(std::uncaught_exception())
+	{
+		// Forcing the exit now would prevent the caller from handling the exception in flight,
+		// and DestroyJavaVM could wait without bound, so the JVM is left to be torn down along
+		// with the process
+		return;
+
+	}
+
+	// Run the shutdown hooks via Runtime.exit, which ends in the exit hook forcing the process
+	// to exit. This is done even when no non-daemon threads remain, as DestroyJavaVM would wait
+	// without bound for any started since they were counted, and would then perform a full
+	// native teardown
+	const int exitCode = (remainingThreads == 0) ? 0 : shutdownExitCode;
+	exitHookStartTime = highResolutionTime();
+
+	jclass runtimeClass = jniEnvironment->FindClass("java/lang/Runtime");
+	jmethodID getRuntime = (runtimeClass == NULL) ? NULL :
+		jniEnvironment->GetStaticMethodID(runtimeClass, "getRuntime", "()Ljava/lang/Runtime;");
+	jmethodID exitMethod = (runtimeClass == NULL) ? NULL :
+		jniEnvironment->GetMethodID(runtimeClass, "exit", "(I)V");
+	jobject runtime = (getRuntime == NULL) ? NULL :
+		jniEnvironment->CallStaticObjectMethod(runtimeClass, getRuntime);
+	if(runtime != NULL && exitMethod != NULL)
+	{
+		jniEnvironment->CallVoidMethod(runtime, exitMethod, static_cast<jint>(exitCode));
+
+	}
+
+	// Only reached if Runtime.exit could not be called, or the JVM ignored the exit hook
+	reportShutdownPhase(SHUTDOWN_EXIT, exitHookStartTime);
+	forceExit(exitCode);
+
+} // jvminvoke::JavaVM::shutdown
+
+/* ********************************************************************************************** */
+int jvminvoke::JavaVM::countNonDaemonThreads()
+{
+	if(jniEnvironment->PushLocalFrame(16) != JNI_OK)
+	{
+		jniEnvironment->ExceptionClear();
+		return -1;
+
+	}
+
+	const int count = countNonDaemonThreadsInFrame(jniEnvironment);
+	jniEnvironment->ExceptionClear();
+	jniEnvironment->PopLocalFrame(NULL);
+	return count;
+
+} // jvminvoke::JavaVM::countNonDaemonThreads
+
+/* ********************************************************************************************** */
+void jvminvoke::JavaVM::reportShutdownPhase(ShutdownPhase phase, jlong startTime)
+{
+	if(shutdownCallback != NULL)
+	{
+		shutdownCallback(phase, highResolutionTime() - startTime);
+
+	}
+
+} // jvminvoke::JavaVM::reportShutdownPhase
 
 /* ********************************************************************************************** */
 jvminvoke::JavaException jvminvoke::JavaVM::createJavaException(std::string message,
@@ -56,15 +460,9 @@ void jvminvoke::JavaVM::createJavaVM(JNI_CreateJavaVM_f JNI_CreateJavaVM,
 	jvmArguments.ignoreUnrecognized = JNI_FALSE;
 	jvmArguments.version = JNI_VERSION_1_6;
 
-	std::auto_ptr<JavaVMOption> jvmOptions;
+	std::vector<JavaVMOption> jvmOptions;
 	std::auto_ptr<char> classPathPointer;
-	if(classPathEntries.empty())
-	{
-		jvmArguments.nOptions = 0;
-		jvmArguments.options = NULL;
-
-	}
-	else
+	if(!classPathEntries.empty())
 	{
 		std::string classPath("-Djava.class.path=");
 		std::list<std::string>::iterator i;
@@ -81,14 +479,23 @@ void jvminvoke::JavaVM::createJavaVM(JNI_CreateJavaVM_f JNI_CreateJavaVM,
 
 		}
 
-		jvmOptions.reset(new JavaVMOption);
 		classPathPointer.reset(_strdup(classPath.c_str()));
-		jvmOptions->optionString = classPathPointer.get();
-		jvmArguments.nOptions = 1;
-		jvmArguments.options = jvmOptions.get();
+		JavaVMOption classPathOption;
+		classPathOption.optionString = classPathPointer.get();
+		classPathOption.extraInfo = NULL;
+		jvmOptions.push_back(classPathOption);
 
 	}
 
+	// Replace the JVM's orderly process exit with a forced exit once the shutdown hooks have run
+	JavaVMOption exitOption;
+	exitOption.optionString = const_cast<char*>("exit");
+	exitOption.extraInfo = reinterpret_cast<void*>(exitHook);
+	jvmOptions.push_back(exitOption);
+
+	jvmArguments.nOptions = static_cast<jint>(jvmOptions.size());
+	jvmArguments.options = &jvmOptions[0];
+
 	jint returnCode = JNI_CreateJavaVM(&javaVM, reinterpret_cast<void**>(&jniEnvironment),
 			&jvmArguments);
 	if(returnCode != JNI_OK)
@@ -97,8 +504,69 @@ void jvminvoke::JavaVM::createJavaVM(JNI_CreateJavaVM_f JNI_CreateJavaVM,
 
 	}
 
+	registerHostIntrinsics();
+
 } // jvminvoke::JavaVM::createJavaVM
 
+/* ********************************************************************************************** */
+void jvminvoke::JavaVM::registerHostIntrinsics()
+{
+	jthrowable javaException;
+
+	jclass classLoaderClass = jniEnvironment->FindClass("java/lang/ClassLoader");
+	javaException = jniEnvironment->ExceptionOccurred();
+	if(javaException != NULL)
+	{
+		throw createJavaException("Failed to load java.lang.ClassLoader class", javaException);
+
+	}
+
+	jmethodID getSystemClassLoader = jniEnvironment->GetStaticMethodID(classLoaderClass,
+			"getSystemClassLoader", "()Ljava/lang/ClassLoader;");
+	javaException = jniEnvironment->ExceptionOccurred();
+	if(javaException != NULL)
+	{
+		throw createJavaException("Failed to load getSystemClassLoader method", javaException);
+
+	}
+
+	jobject systemClassLoader = jniEnvironment->CallStaticObjectMethod(classLoaderClass,
+			getSystemClassLoader);
+	javaException = jniEnvironment->ExceptionOccurred();
+	if(javaException != NULL)
+	{
+		throw createJavaException("Failed to retrieve the system class loader", javaException);
+
+	}
+
+	// Defining the class in the system class loader makes it visible to child class loaders
+	// through parent delegation
+	jclass intrinsicsClass = jniEnvironment->DefineClass(hostIntrinsicsClassName.c_str(),
+			systemClassLoader, reinterpret_cast<const jbyte*>(hostIntrinsicsClassBytes),
+			sizeof(hostIntrinsicsClassBytes));
+	javaException = jniEnvironment->ExceptionOccurred();
+	if(javaException != NULL)
+	{
+		throw createJavaException("Failed to define " + hostIntrinsicsClassName, javaException);
+
+	}
+
+	jniEnvironment->RegisterNatives(intrinsicsClass, hostIntrinsics,
+			sizeof(hostIntrinsics) / sizeof(hostIntrinsics[0]));
+	javaException = jniEnvironment->ExceptionOccurred();
+	if(javaException != NULL)
+	{
+		throw createJavaException("Failed to register native methods of " +
+				hostIntrinsicsClassName, javaException);
+
+	}
+
+	jniEnvironment->DeleteLocalRef(intrinsicsClass);
+	jniEnvironment->DeleteLocalRef(systemClassLoader);
+	jniEnvironment->DeleteLocalRef(classLoaderClass);
+
+} // jvminvoke::JavaVM::registerHostIntrinsics
+
 /* ********************************************************************************************** */
 void jvminvoke::JavaVM::executeJAR(const std::string jarPath, const std::string mainClassName)
 {
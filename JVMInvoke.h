@@ -28,6 +28,64 @@ namespace jvminvoke
 	 */
 	typedef jint (JNICALL *JNI_CreateJavaVM_f)(::JavaVM**, void**, void*);
 
+	/**
+	 * Phases of the Java Virtual Machine shutdown sequence, as reported to a ShutdownCallback_f.
+	 */
+	enum ShutdownPhase
+	{
+		/** Waiting, up to the shutdown timeout, for the application's non-daemon threads to
+		 *  terminate. */
+		SHUTDOWN_WAIT_FOR_THREADS,
+		/** Destroying the JVM with an infinite shutdown timeout, including waiting for the
+		 *  non-daemon threads to terminate and running shutdown hooks. */
+		SHUTDOWN_DESTROY,
+		/** Exiting the JVM via <code>Runtime.exit</code>, up to the point where the shutdown hooks
+		 *  have run and the process is forcibly exited. If the application calls
+		 *  <code>System.exit</code> while the JVM is being shut down, this replaces the phase in
+		 *  progress, and its time is measured from the start of that phase. */
+		SHUTDOWN_EXIT
+
+	}; // enum ShutdownPhase
+
+	/**
+	 * Function pointer invoked upon completion of each phase of the Java Virtual Machine shutdown
+	 * sequence, receiving the phase and the time it took, in nanoseconds.
+	 */
+	typedef void (*ShutdownCallback_f)(ShutdownPhase, jlong);
+
+	/**
+	 * Shutdown timeout value indicating that the JVM should wait indefinitely for its non-daemon
+	 * threads to terminate.
+	 */
+	const long infiniteShutdownTimeout = -1;
+
+	/**
+	 * Fully-qualified name (with components separated by slash characters) of the built-in Java
+	 * class whose native methods are bound to the host intrinsics when the Java Virtual Machine is
+	 * created.
+	 *
+	 * The class is embedded in the wrapper and defined in the system class loader, so that it is
+	 * visible to the application's classes, including those loaded by child class loaders. It is
+	 * equivalent to the following source:
+	 *
+	 * <pre>
+	 * package jvminvoke;
+	 *
+	 * public final class HostIntrinsics {
+	 *     public static native long nanoTime();
+	 *     public static native boolean pinCurrentThread(int processor);
+	 *     public static native int currentProcessor();
+	 *     public static native int currentNumaNode();
+	 *     public static native boolean prefetchFile(String path);
+	 * }
+	 * </pre>
+	 *
+	 * No <code>System.loadLibrary</code> call is required, as the implementations are registered
+	 * directly from the wrapper executable. The methods taking only primitive arguments are also
+	 * exported as critical natives, which the JVM may call without the usual JNI transition.
+	 */
+	const std::string hostIntrinsicsClassName = "jvminvoke/HostIntrinsics";
+
 	/**
 	 * Base exception class.
 	 */
@@ -137,8 +195,7 @@ namespace jvminvoke
 			/**
 			 * Shuts down any Java Virtual Machine instance created during the wrapper's lifetime.
 			 *
-			 * If the invoked JVM started any non-daemon threads, the JVM will remain active until
-			 * the last non-daemon thread also terminates.
+			 * @see shutdown()
 			 */
 			~JavaVM();
 
@@ -162,6 +219,50 @@ namespace jvminvoke
 			 *                      exception types.
 			 */
 			void executeJAR(const std::string jarPath, const std::string mainClass);
+			/**
+			 * Shuts down the Java Virtual Machine instance, if one was created.
+			 *
+			 * With an infinite shutdown timeout (the default), the JVM is destroyed once its last
+			 * non-daemon thread terminates, running any registered shutdown hooks, and this method
+			 * returns after a full teardown of the JVM.
+			 *
+			 * With a finite timeout, this method waits for the non-daemon threads to terminate,
+			 * for no longer than the timeout. <code>Runtime.exit</code> is then called to run the
+			 * shutdown hooks, after which the process is forcibly exited without waiting for any
+			 * remaining threads, and without an orderly native teardown; this method does not
+			 * return. The exit code is 0 if all non-daemon threads terminated in time, or the code
+			 * given to setShutdownTimeout otherwise.
+			 *
+			 * If the application calls <code>System.exit</code>, the process is likewise forcibly
+			 * exited as soon as the shutdown hooks have run.
+			 *
+			 * If this method is called (for example, by the destructor) while an exception is
+			 * propagating and a finite timeout is set, the JVM is neither destroyed nor exited once
+			 * the wait ends. It is instead left running, so that the exception can be handled, and
+			 * is torn down when the process exits.
+			 */
+			void shutdown();
+			/**
+			 * Sets the time to wait for the JVM's non-daemon threads to terminate before forcing
+			 * the process to exit.
+			 *
+			 * @param milliseconds the graceful shutdown timeout, or infiniteShutdownTimeout (the
+			 *                     default) to wait indefinitely
+			 * @param exitCode     the process exit code to be used if the timeout elapses, which
+			 *                     defaults to a non-zero value so that a timed-out shutdown is not
+			 *                     mistaken for a successful one
+			 */
+			void setShutdownTimeout(const long milliseconds, const int exitCode = 1);
+			/**
+			 * Sets the function to be notified of the time taken by each phase of the shutdown
+			 * sequence.
+			 *
+			 * The SHUTDOWN_EXIT phase is reported from a JVM thread. If the application calls
+			 * <code>System.exit</code> before shutdown() is called, no phase is reported.
+			 *
+			 * @param callback the function to notify, or <code>NULL</code> to disable reporting
+			 */
+			void setShutdownCallback(ShutdownCallback_f callback);
 
 		private:
 			/**
@@ -179,6 +280,9 @@ namespace jvminvoke
 			/**
 			 * Creates an instance of the Java Virtual Machine.
 			 *
+			 * Once the JVM has been created, the host intrinsics class is defined and its native
+			 * methods registered.
+			 *
 			 * @param JNI_CreateJavaVM a pointer to the <code>JNI_CreateJavaVM</code> function
 			 *                         exported by the JVM dynamic-link library
 			 * @param classPathEntries an optional list of filesystem paths to directories and/or
@@ -186,13 +290,40 @@ namespace jvminvoke
 			 *
 			 * @throw RuntimeException If an error occurs while interacting with the Java Native
 			 *                         Interface API to create the JVM instance.
+			 * @throw JavaException    If the host intrinsics class could not be defined or its
+			 *                         native methods registered.
 			 */
 			void createJavaVM(JNI_CreateJavaVM_f JNI_CreateJavaVM,
 					std::list<std::string> classPathEntries = std::list<std::string>());
+			/**
+			 * Defines the class named by hostIntrinsicsClassName in the system class loader, and
+			 * binds the host intrinsics to its native methods.
+			 *
+			 * @throw JavaException If the Java Virtual Machine raises a Java exception while
+			 *                      defining the class or registering its native methods.
+			 */
+			void registerHostIntrinsics();
+			/**
+			 * Counts the live non-daemon threads in the JVM, excluding the calling thread.
+			 *
+			 * @return the number of live non-daemon threads, or <code>-1</code> if they could not
+			 *         be enumerated
+			 */
+			int countNonDaemonThreads();
+			/**
+			 * Reports the time taken by a shutdown phase to the shutdown callback, if one is set.
+			 *
+			 * @param phase     the shutdown phase that completed
+			 * @param startTime the value of highResolutionTime() at the start of the phase
+			 */
+			void reportShutdownPhase(ShutdownPhase phase, jlong startTime);
 
 			::JavaVM *javaVM;
 			JNIEnv *jniEnvironment;
 			string jvmDLLPath;
+			long shutdownTimeout;
+			int shutdownExitCode;
+			ShutdownCallback_f shutdownCallback;
 
 	}; // class JavaVM
 
@@ -235,6 +366,76 @@ namespace jvminvoke
 	 *                         to load the DLL and function.
 	 */
 	JNI_CreateJavaVM_f importCreateJavaVMFromDLL(const string jvmDLLPath);
+	/**
+	 * Reads a monotonic, high-resolution clock.
+	 *
+	 * This is a platform-specific method.
+	 *
+	 * @return the current value of the clock, in nanoseconds relative to an arbitrary origin
+	 */
+	jlong highResolutionTime();
+	/**
+	 * Restricts the calling thread to execute only on the specified logical processor.
+	 *
+	 * This is a platform-specific method. On Windows, processors are partitioned into groups; the
+	 * index of a processor is its number within its group, plus its group multiplied by the number
+	 * of bits in an affinity mask (64 in a 64-bit process, or 32 in a 32-bit one). This matches
+	 * the value returned by currentProcessor(), and may move the thread to another group.
+	 *
+	 * @param  processor the zero-based index of the logical processor
+	 * @return <code>true</code> if the thread's affinity was changed, or <code>false</code> if the
+	 *         processor index is out of range or the platform rejected the request
+	 */
+	bool pinCurrentThread(const int processor);
+	/**
+	 * Determines the logical processor on which the calling thread is executing.
+	 *
+	 * This is a platform-specific method. On Windows, the index includes the processor group, as
+	 * described for pinCurrentThread().
+	 *
+	 * @return the zero-based index of the logical processor, or <code>-1</code> if it cannot be
+	 *         determined on this platform
+	 */
+	int currentProcessor();
+	/**
+	 * Determines the NUMA node of the logical processor on which the calling thread is executing.
+	 *
+	 * This is a platform-specific method.
+	 *
+	 * @return the number of the NUMA node, or <code>-1</code> if it cannot be determined on this
+	 *         platform
+	 */
+	int currentNumaNode();
+	/**
+	 * Hints to the operating system that the contents of a file will be read in the near future.
+	 *
+	 * The file's contents are read into the system file cache asynchronously; this method does not
+	 * wait for the read to complete.
+	 *
+	 * This is a platform-specific method.
+	 *
+	 * @param  path a filesystem path referencing the file to prefetch
+	 * @return <code>true</code> if the prefetch was issued, or <code>false</code> if the file could
+	 *         not be opened or the platform does not support prefetching
+	 */
+	bool prefetchFile(const std::wstring path);
+	/**
+	 * Suspends the calling thread for at least the specified time.
+	 *
+	 * This is a platform-specific method.
+	 *
+	 * @param milliseconds the time to sleep for
+	 */
+	void sleepMilliseconds(const unsigned long milliseconds);
+	/**
+	 * Terminates the process immediately, without running any native teardown such as static
+	 * destructors or <code>atexit</code> handlers.
+	 *
+	 * This is a platform-specific method.
+	 *
+	 * @param exitCode the process exit code
+	 */
+	void forceExit(const int exitCode);
 
 } // namespace jvminvoke
 
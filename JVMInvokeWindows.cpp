@@ -14,6 +14,109 @@
 /* ********************************************************************************************** */
 namespace
 {
+	/**
+	 * Layout-compatible equivalent of the Win32 <code>WIN32_MEMORY_RANGE_ENTRY</code> structure,
+	 * which is not declared by all supported SDK versions.
+	 */
+	struct MemoryRangeEntry
+	{
+		PVOID virtualAddress;
+		SIZE_T numberOfBytes;
+
+	}; // struct MemoryRangeEntry
+
+	/**
+	 * Layout-compatible equivalent of the Win32 <code>PROCESSOR_NUMBER</code> structure, which is
+	 * not declared by all supported SDK versions.
+	 */
+	struct ProcessorNumber
+	{
+		WORD group;
+		BYTE number;
+		BYTE reserved;
+
+	}; // struct ProcessorNumber
+
+	/**
+	 * Layout-compatible equivalent of the Win32 <code>GROUP_AFFINITY</code> structure, which is not
+	 * declared by all supported SDK versions.
+	 */
+	struct GroupAffinity
+	{
+		ULONG_PTR mask;
+		WORD group;
+		WORD reserved[3];
+
+	}; // struct GroupAffinity
+
+	/**
+	 * Number of logical processors addressable by an affinity mask, and therefore the maximum size
+	 * of a processor group. Processor indices are formed from a group and the number of the
+	 * processor within it as <code>group * processorsPerGroup + number</code>.
+	 */
+	const int processorsPerGroup = static_cast<int>(sizeof(ULONG_PTR) * 8);
+
+	/**
+	 * Function pointer corresponding to the <code>GetCurrentProcessorNumber</code> Win32 function,
+	 * available from Windows Vista onwards.
+	 */
+	typedef DWORD (WINAPI *GetCurrentProcessorNumber_f)(VOID);
+	/**
+	 * Function pointer corresponding to the <code>GetCurrentProcessorNumberEx</code> Win32
+	 * function, available from Windows 7 onwards.
+	 */
+	typedef VOID (WINAPI *GetCurrentProcessorNumberEx_f)(ProcessorNumber*);
+	/**
+	 * Function pointer corresponding to the <code>GetNumaProcessorNodeEx</code> Win32 function,
+	 * available from Windows 7 onwards.
+	 */
+	typedef BOOL (WINAPI *GetNumaProcessorNodeEx_f)(ProcessorNumber*, PUSHORT);
+	/**
+	 * Function pointer corresponding to the <code>SetThreadGroupAffinity</code> Win32 function,
+	 * available from Windows 7 onwards.
+	 */
+	typedef BOOL (WINAPI *SetThreadGroupAffinity_f)(HANDLE, const GroupAffinity*, GroupAffinity*);
+	/**
+	 * Function pointer corresponding to the <code>PrefetchVirtualMemory</code> Win32 function,
+	 * available from Windows 8 onwards.
+	 */
+	typedef BOOL (WINAPI *PrefetchVirtualMemory_f)(HANDLE, ULONG_PTR, MemoryRangeEntry*, ULONG);
+
+	/**
+	 * Retrieves the frequency of the performance counter, which is fixed at system boot.
+	 *
+	 * @return the number of performance counter ticks per second
+	 */
+	LONGLONG queryPerformanceFrequency()
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return frequency.QuadPart;
+
+	} // queryPerformanceFrequency
+
+	const LONGLONG performanceFrequency = queryPerformanceFrequency();
+
+	/*
+	 * Functions not available on every supported version of Windows are resolved at run-time, and
+	 * are NULL when the running system does not export them.
+	 */
+	const GetCurrentProcessorNumber_f GetCurrentProcessorNumberOrNull =
+		reinterpret_cast<GetCurrentProcessorNumber_f>(GetProcAddress(
+					GetModuleHandle(_T("kernel32.dll")), "GetCurrentProcessorNumber"));
+	const GetCurrentProcessorNumberEx_f GetCurrentProcessorNumberExOrNull =
+		reinterpret_cast<GetCurrentProcessorNumberEx_f>(GetProcAddress(
+					GetModuleHandle(_T("kernel32.dll")), "GetCurrentProcessorNumberEx"));
+	const GetNumaProcessorNodeEx_f GetNumaProcessorNodeExOrNull =
+		reinterpret_cast<GetNumaProcessorNodeEx_f>(GetProcAddress(
+					GetModuleHandle(_T("kernel32.dll")), "GetNumaProcessorNodeEx"));
+	const SetThreadGroupAffinity_f SetThreadGroupAffinityOrNull =
+		reinterpret_cast<SetThreadGroupAffinity_f>(GetProcAddress(
+					GetModuleHandle(_T("kernel32.dll")), "SetThreadGroupAffinity"));
+	const PrefetchVirtualMemory_f PrefetchVirtualMemoryOrNull =
+		reinterpret_cast<PrefetchVirtualMemory_f>(GetProcAddress(
+					GetModuleHandle(_T("kernel32.dll")), "PrefetchVirtualMemory"));
+
 	/**
 	 * Retrieves a <code>REG_SZ</code> typed value from the registry.
 	 *
@@ -164,5 +267,181 @@ jvminvoke::JNI_CreateJavaVM_f jvminvoke::importCreateJavaVMFromDLL(const string
 
 } // jvminvoke::importCreateJavaVMFromDLL
 
+/* ********************************************************************************************** */
+jlong jvminvoke::highResolutionTime()
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// Split the conversion into whole seconds and a remainder to avoid overflowing the product
+	const LONGLONG seconds = counter.QuadPart / performanceFrequency;
+	const LONGLONG remainder = counter.QuadPart % performanceFrequency;
+	return static_cast<jlong>(seconds * 1000000000LL +
+			remainder * 1000000000LL / performanceFrequency);
+
+} // jvminvoke::highResolutionTime
+
+/* ********************************************************************************************** */
+bool jvminvoke::pinCurrentThread(const int processor)
+{
+	if(processor < 0)
+	{
+		return false;
+
+	}
+
+	const WORD group = static_cast<WORD>(processor / processorsPerGroup);
+	const ULONG_PTR mask = static_cast<ULONG_PTR>(1) << (processor % processorsPerGroup);
+	if(SetThreadGroupAffinityOrNull != NULL)
+	{
+		GroupAffinity affinity = { mask, group, { 0, 0, 0 } };
+		return (SetThreadGroupAffinityOrNull(GetCurrentThread(), &affinity, NULL) != FALSE);
+
+	}
+
+	// Prior to Windows 7, all processors belong to group 0
+	if(group != 0)
+	{
+		return false;
+
+	}
+
+	return (SetThreadAffinityMask(GetCurrentThread(), mask) != 0);
+
+} // jvminvoke::pinCurrentThread
+
+/* ********************************************************************************************** */
+int jvminvoke::currentProcessor()
+{
+	if(GetCurrentProcessorNumberExOrNull != NULL)
+	{
+		ProcessorNumber processor;
+		GetCurrentProcessorNumberExOrNull(&processor);
+		return processor.group * processorsPerGroup + processor.number;
+
+	}
+
+	// Prior to Windows 7, all processors belong to group 0
+	if(GetCurrentProcessorNumberOrNull == NULL)
+	{
+		return -1;
+
+	}
+
+	return static_cast<int>(GetCurrentProcessorNumberOrNull());
+
+} // jvminvoke::currentProcessor
+
+/* ********************************************************************************************** */
+int jvminvoke::currentNumaNode()
+{
+	if(GetCurrentProcessorNumberExOrNull != NULL && GetNumaProcessorNodeExOrNull != NULL)
+	{
+		// GetNumaProcessorNode only accepts group 0 processors, so the group must be passed too
+		ProcessorNumber processor;
+		GetCurrentProcessorNumberExOrNull(&processor);
+		USHORT node;
+		if(!GetNumaProcessorNodeExOrNull(&processor, &node))
+		{
+			return -1;
+
+		}
+
+		return node;
+
+	}
+
+	const int processor = currentProcessor();
+	if(processor < 0)
+	{
+		return -1;
+
+	}
+
+	UCHAR node;
+	if(!GetNumaProcessorNode(static_cast<UCHAR>(processor), &node))
+	{
+		return -1;
+
+	}
+
+	return node;
+
+} // jvminvoke::currentNumaNode
+
+/* ********************************************************************************************** */
+bool jvminvoke::prefetchFile(const std::wstring path)
+{
+	if(PrefetchVirtualMemoryOrNull == NULL)
+	{
+		return false;
+
+	}
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+
+	}
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+
+	}
+	else if(fileSize.QuadPart == 0)
+	{
+		// An empty file cannot be mapped, but there is equally nothing to prefetch
+		CloseHandle(file);
+		return true;
+
+	}
+
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping == NULL)
+	{
+		return false;
+
+	}
+
+	// The view only needs to exist while the prefetch is issued; the pages it brings in are kept
+	// in the system file cache after the view is unmapped
+	LPVOID view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(view == NULL)
+	{
+		return false;
+
+	}
+
+	MemoryRangeEntry range;
+	range.virtualAddress = view;
+	range.numberOfBytes = static_cast<SIZE_T>(fileSize.QuadPart);
+	const BOOL result = PrefetchVirtualMemoryOrNull(GetCurrentProcess(), 1, &range, 0);
+	UnmapViewOfFile(view);
+	return (result != FALSE);
+
+} // jvminvoke::prefetchFile
+
+/* ********************************************************************************************** */
+void jvminvoke::sleepMilliseconds(const unsigned long milliseconds)
+{
+	Sleep(milliseconds);
+
+} // jvminvoke::sleepMilliseconds
+
+/* ********************************************************************************************** */
+void jvminvoke::forceExit(const int exitCode)
+{
+	TerminateProcess(GetCurrentProcess(), static_cast<UINT>(exitCode));
+
+} // jvminvoke::forceExit
+
 /* ********************************************************************************************** */
 // vim: set ts=4 sw=4 noet: